@@ -0,0 +1,346 @@
+#include "chiller_cache.h"
+
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <functional>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <utime.h>
+#endif
+
+// Only files with this suffix are ever trimmed
+#define CHILLER_CACHE_SUFFIX ".chidx"
+
+#ifdef _WIN32
+static const char chiller_cache_separator = '\\';
+#else
+static const char chiller_cache_separator = '/';
+#endif
+
+static std::string chiller_cache_path(const std::string& dir, const std::string& name) {
+    return dir + chiller_cache_separator + name;
+}
+
+std::string chiller_cache_default_dir(void) {
+#ifdef _WIN32
+    const char *base = getenv("LOCALAPPDATA");
+    if (base && *base) {
+        return std::string(base) + "\\chiller~\\Cache";
+    }
+    const char *temp = getenv("TEMP");
+    return std::string(temp ? temp : ".") + "\\chiller~";
+#elif defined(__APPLE__)
+    const char *home = getenv("HOME");
+    return std::string(home ? home : "/tmp") + "/Library/Caches/chiller~";
+#else
+    const char *xdg = getenv("XDG_CACHE_HOME");
+    if (xdg && *xdg) {
+        return std::string(xdg) + "/chiller~";
+    }
+    const char *home = getenv("HOME");
+    return std::string(home ? home : "/tmp") + "/.cache/chiller~";
+#endif
+}
+
+static inline uint64_t chiller_cache_rotl(uint64_t v, int r) {
+    return (v << r) | (v >> (64 - r));
+}
+
+uint64_t chiller_cache_hash(const void *data, size_t size, uint64_t seed) {
+    // Four independent multiply-rotate lanes over 8-byte words (the xxHash64
+    // round), merged and avalanched at the end. Not cryptographic, but fast
+    // enough to key buffers of many minutes on every load.
+    const uint64_t p1 = 0x9E3779B185EBCA87ULL;
+    const uint64_t p2 = 0xC2B2AE3D27D4EB4FULL;
+    const uint8_t *bytes = (const uint8_t *)data;
+    uint64_t lane[4] = { seed + p1 + p2, seed + p2, seed, seed - p1 };
+    size_t i = 0;
+
+    for (; i + 32 <= size; i += 32) {
+        for (int k = 0; k < 4; k++) {
+            uint64_t word;
+            memcpy(&word, bytes + i + 8 * k, sizeof(word));
+            lane[k] = chiller_cache_rotl(lane[k] + word * p2, 31) * p1;
+        }
+    }
+
+    uint64_t h = chiller_cache_rotl(lane[0], 1) + chiller_cache_rotl(lane[1], 7)
+               + chiller_cache_rotl(lane[2], 12) + chiller_cache_rotl(lane[3], 18);
+    h += (uint64_t)size;
+    for (; i < size; i++) {
+        h = chiller_cache_rotl(h ^ (bytes[i] * p1), 11) * p2;
+    }
+
+    h ^= h >> 33;
+    h *= p2;
+    h ^= h >> 29;
+    h *= p1;
+    h ^= h >> 32;
+    return h;
+}
+
+static bool chiller_cache_make_dir(const std::string& dir) {
+    // Create each missing component in turn
+    for (size_t pos = 1; pos <= dir.size(); pos++) {
+        if (pos < dir.size() && dir[pos] != '/' && dir[pos] != '\\') {
+            continue;
+        }
+        std::string partial = dir.substr(0, pos);
+#ifdef _WIN32
+        if (partial.size() == 2 && partial[1] == ':') {
+            continue;  // Drive letter
+        }
+        CreateDirectoryA(partial.c_str(), NULL);
+#else
+        mkdir(partial.c_str(), 0755);
+#endif
+    }
+
+#ifdef _WIN32
+    DWORD attributes = GetFileAttributesA(dir.c_str());
+    return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY);
+#else
+    struct stat info;
+    return stat(dir.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+#endif
+}
+
+bool chiller_cache_open(const std::string& dir, const std::string& name, t_chiller_mapping *map) {
+    std::string path = chiller_cache_path(dir, name);
+    map->data = NULL;
+    map->size = 0;
+
+#ifdef _WIN32
+    map->file = NULL;
+    map->mapping = NULL;
+
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mapping) {
+        CloseHandle(file);
+        return false;
+    }
+
+    void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!data) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+
+    // Mark as recently used for trimming
+    FILETIME now;
+    GetSystemTimeAsFileTime(&now);
+    HANDLE touch = CreateFileA(path.c_str(), FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                               NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (touch != INVALID_HANDLE_VALUE) {
+        SetFileTime(touch, NULL, NULL, &now);
+        CloseHandle(touch);
+    }
+
+    map->file = file;
+    map->mapping = mapping;
+    map->data = (const uint8_t *)data;
+    map->size = (size_t)size.QuadPart;
+    return true;
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        close(fd);
+        return false;
+    }
+
+    void *data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);  // The mapping keeps the file alive
+    if (data == MAP_FAILED) {
+        return false;
+    }
+
+    // Mark as recently used for trimming
+    utime(path.c_str(), NULL);
+
+    map->data = (const uint8_t *)data;
+    map->size = (size_t)info.st_size;
+    return true;
+#endif
+}
+
+void chiller_cache_close(t_chiller_mapping *map) {
+    if (!map->data) {
+        return;
+    }
+
+#ifdef _WIN32
+    UnmapViewOfFile(map->data);
+    CloseHandle(map->mapping);
+    CloseHandle(map->file);
+    map->file = NULL;
+    map->mapping = NULL;
+#else
+    munmap((void *)map->data, map->size);
+#endif
+    map->data = NULL;
+    map->size = 0;
+}
+
+void chiller_cache_prefault(const t_chiller_mapping *map) {
+    if (!map->data) {
+        return;
+    }
+
+    // Ask for read-ahead of the whole file, then touch one byte per page so
+    // each is actually resident before the mapping is used
+    size_t page;
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    page = info.dwPageSize;
+#else
+    madvise((void *)map->data, map->size, MADV_WILLNEED);
+    long page_size = sysconf(_SC_PAGESIZE);
+    page = page_size > 0 ? (size_t)page_size : 4096;
+#endif
+    volatile uint8_t sink = 0;
+    for (size_t offset = 0; offset < map->size; offset += page) {
+        sink ^= map->data[offset];
+    }
+    sink ^= map->data[map->size - 1];
+    (void)sink;
+}
+
+bool chiller_cache_write(const std::string& dir, const std::string& name, const void *header, size_t header_size, const void *data, size_t size) {
+    if (!chiller_cache_make_dir(dir)) {
+        return false;
+    }
+
+    // Unique temporary name per process and thread, renamed into place once
+    // complete; concurrent writers of the same entry write identical bytes
+    char suffix[64];
+#ifdef _WIN32
+    snprintf(suffix, sizeof(suffix), ".%d.%zx.tmp", _getpid(), std::hash<std::thread::id>()(std::this_thread::get_id()));
+#else
+    snprintf(suffix, sizeof(suffix), ".%d.%zx.tmp", (int)getpid(), std::hash<std::thread::id>()(std::this_thread::get_id()));
+#endif
+    std::string path = chiller_cache_path(dir, name);
+    std::string temp = path + suffix;
+
+    FILE *file = fopen(temp.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    bool ok = fwrite(header, 1, header_size, file) == header_size
+           && fwrite(data, 1, size, file) == size;
+    ok = (fclose(file) == 0) && ok;
+
+#ifdef _WIN32
+    ok = ok && MoveFileExA(temp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING);
+#else
+    ok = ok && rename(temp.c_str(), path.c_str()) == 0;
+#endif
+    if (!ok) {
+        remove(temp.c_str());
+    }
+    return ok;
+}
+
+void chiller_cache_remove(const std::string& dir, const std::string& name) {
+    remove(chiller_cache_path(dir, name).c_str());
+}
+
+typedef struct _chiller_cache_entry {
+    std::string name;
+    uint64_t size;
+    int64_t last_used;
+} t_chiller_cache_entry;
+
+static bool chiller_cache_is_entry(const char *name) {
+    size_t length = strlen(name);
+    size_t suffix = strlen(CHILLER_CACHE_SUFFIX);
+    return length > suffix && strcmp(name + length - suffix, CHILLER_CACHE_SUFFIX) == 0;
+}
+
+void chiller_cache_trim(const std::string& dir, uint64_t max_bytes) {
+    std::vector<t_chiller_cache_entry> entries;
+    uint64_t total = 0;
+
+#ifdef _WIN32
+    WIN32_FIND_DATAA found;
+    HANDLE search = FindFirstFileA(chiller_cache_path(dir, "*" CHILLER_CACHE_SUFFIX).c_str(), &found);
+    if (search == INVALID_HANDLE_VALUE) {
+        return;
+    }
+    do {
+        if (!(found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && chiller_cache_is_entry(found.cFileName)) {
+            t_chiller_cache_entry entry;
+            entry.name = found.cFileName;
+            entry.size = ((uint64_t)found.nFileSizeHigh << 32) | found.nFileSizeLow;
+            entry.last_used = ((int64_t)found.ftLastWriteTime.dwHighDateTime << 32) | found.ftLastWriteTime.dwLowDateTime;
+            entries.push_back(entry);
+            total += entry.size;
+        }
+    } while (FindNextFileA(search, &found));
+    FindClose(search);
+#else
+    DIR *listing = opendir(dir.c_str());
+    if (!listing) {
+        return;
+    }
+    while (struct dirent *item = readdir(listing)) {
+        struct stat info;
+        if (!chiller_cache_is_entry(item->d_name) || stat(chiller_cache_path(dir, item->d_name).c_str(), &info) != 0) {
+            continue;
+        }
+        t_chiller_cache_entry entry;
+        entry.name = item->d_name;
+        entry.size = (uint64_t)info.st_size;
+        entry.last_used = (int64_t)info.st_mtime;
+        entries.push_back(entry);
+        total += entry.size;
+    }
+    closedir(listing);
+#endif
+
+    if (total <= max_bytes) {
+        return;
+    }
+
+    // Oldest first. Entries still mapped elsewhere stay valid for those users
+    // on POSIX; on Windows their deletion fails and they are retried next time.
+    std::sort(entries.begin(), entries.end(), [](const t_chiller_cache_entry& a, const t_chiller_cache_entry& b) {
+        return a.last_used < b.last_used;
+    });
+    for (size_t i = 0; i < entries.size() && total > max_bytes; i++) {
+        if (remove(chiller_cache_path(dir, entries[i].name).c_str()) == 0) {
+            total -= entries[i].size;
+        }
+    }
+}
@@ -0,0 +1,48 @@
+// On-disk cache of buffer analyses for chiller~.
+//
+// Entries are plain files in a cache directory, named by the caller from a
+// hash of everything the analysis depends on. They are written once to a
+// temporary name and renamed into place, so readers never see a partial
+// file, and read back through a read-only memory mapping: pages load lazily
+// and are shared by every instance and process mapping the same entry.
+// Least recently used entries are deleted to keep the directory under a
+// size limit.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+typedef struct _chiller_mapping {
+    const uint8_t *data;   // Start of the file, NULL when not mapped
+    size_t size;           // File size in bytes
+#ifdef _WIN32
+    void *file;            // HANDLE of the file
+    void *mapping;         // HANDLE of the file mapping
+#endif
+} t_chiller_mapping;
+
+// Default cache directory for this user (not created until written to)
+std::string chiller_cache_default_dir(void);
+
+// 64-bit hash of a block of memory, continuing from seed
+uint64_t chiller_cache_hash(const void *data, size_t size, uint64_t seed);
+
+// Map an entry read-only. Returns false (with map->data NULL) if it is missing
+// or cannot be mapped. A successful open marks the entry as recently used.
+bool chiller_cache_open(const std::string& dir, const std::string& name, t_chiller_mapping *map);
+void chiller_cache_close(t_chiller_mapping *map);
+
+// Read every page of a mapping into memory now, so that later reads (e.g. on
+// the audio thread) do not wait on the disk. Call from a worker thread.
+void chiller_cache_prefault(const t_chiller_mapping *map);
+
+// Write an entry as header followed by data, creating the directory if needed
+bool chiller_cache_write(const std::string& dir, const std::string& name, const void *header, size_t header_size, const void *data, size_t size);
+
+// Delete an entry, e.g. one that failed validation
+void chiller_cache_remove(const std::string& dir, const std::string& name);
+
+// Delete least recently used entries until the directory holds at most max_bytes
+void chiller_cache_trim(const std::string& dir, uint64_t max_bytes);
@@ -0,0 +1,557 @@
+#include "chiller_dsp.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <mutex>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CHILLER_SIMD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define CHILLER_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+namespace chiller_scalar {
+struct fft_ops {
+    typedef t_chiller_real vec;
+    static const long width = 1;
+    static inline vec load(const t_chiller_real *p) { return *p; }
+    static inline void store(t_chiller_real *p, vec a) { *p = a; }
+    static inline vec add(vec a, vec b) { return a + b; }
+    static inline vec sub(vec a, vec b) { return a - b; }
+    static inline vec mul(vec a, vec b) { return a * b; }
+    static inline vec mul_add(vec a, vec b, vec c) { return a * b + c; }
+    static inline vec mul_sub(vec a, vec b, vec c) { return a * b - c; }
+};
+#include "chiller_fft_kernels.h"
+}
+
+#if CHILLER_SIMD_X86
+namespace chiller_sse2 {
+struct fft_ops {
+#ifdef CHILLER_FLOAT32
+    typedef __m128 vec;
+    static const long width = 4;
+    static inline vec load(const float *p) { return _mm_loadu_ps(p); }
+    static inline void store(float *p, vec a) { _mm_storeu_ps(p, a); }
+    static inline vec add(vec a, vec b) { return _mm_add_ps(a, b); }
+    static inline vec sub(vec a, vec b) { return _mm_sub_ps(a, b); }
+    static inline vec mul(vec a, vec b) { return _mm_mul_ps(a, b); }
+    static inline vec mul_add(vec a, vec b, vec c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+    static inline vec mul_sub(vec a, vec b, vec c) { return _mm_sub_ps(_mm_mul_ps(a, b), c); }
+#else
+    typedef __m128d vec;
+    static const long width = 2;
+    static inline vec load(const double *p) { return _mm_loadu_pd(p); }
+    static inline void store(double *p, vec a) { _mm_storeu_pd(p, a); }
+    static inline vec add(vec a, vec b) { return _mm_add_pd(a, b); }
+    static inline vec sub(vec a, vec b) { return _mm_sub_pd(a, b); }
+    static inline vec mul(vec a, vec b) { return _mm_mul_pd(a, b); }
+    static inline vec mul_add(vec a, vec b, vec c) { return _mm_add_pd(_mm_mul_pd(a, b), c); }
+    static inline vec mul_sub(vec a, vec b, vec c) { return _mm_sub_pd(_mm_mul_pd(a, b), c); }
+#endif
+};
+#include "chiller_fft_kernels.h"
+}
+
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx2,fma"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+#endif
+namespace chiller_avx2 {
+struct fft_ops {
+#ifdef CHILLER_FLOAT32
+    typedef __m256 vec;
+    static const long width = 8;
+    static inline vec load(const float *p) { return _mm256_loadu_ps(p); }
+    static inline void store(float *p, vec a) { _mm256_storeu_ps(p, a); }
+    static inline vec add(vec a, vec b) { return _mm256_add_ps(a, b); }
+    static inline vec sub(vec a, vec b) { return _mm256_sub_ps(a, b); }
+    static inline vec mul(vec a, vec b) { return _mm256_mul_ps(a, b); }
+    static inline vec mul_add(vec a, vec b, vec c) { return _mm256_fmadd_ps(a, b, c); }
+    static inline vec mul_sub(vec a, vec b, vec c) { return _mm256_fmsub_ps(a, b, c); }
+#else
+    typedef __m256d vec;
+    static const long width = 4;
+    static inline vec load(const double *p) { return _mm256_loadu_pd(p); }
+    static inline void store(double *p, vec a) { _mm256_storeu_pd(p, a); }
+    static inline vec add(vec a, vec b) { return _mm256_add_pd(a, b); }
+    static inline vec sub(vec a, vec b) { return _mm256_sub_pd(a, b); }
+    static inline vec mul(vec a, vec b) { return _mm256_mul_pd(a, b); }
+    static inline vec mul_add(vec a, vec b, vec c) { return _mm256_fmadd_pd(a, b, c); }
+    static inline vec mul_sub(vec a, vec b, vec c) { return _mm256_fmsub_pd(a, b, c); }
+#endif
+};
+#include "chiller_fft_kernels.h"
+}
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx512f"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+#endif
+namespace chiller_avx512 {
+struct fft_ops {
+#ifdef CHILLER_FLOAT32
+    typedef __m512 vec;
+    static const long width = 16;
+    static inline vec load(const float *p) { return _mm512_loadu_ps(p); }
+    static inline void store(float *p, vec a) { _mm512_storeu_ps(p, a); }
+    static inline vec add(vec a, vec b) { return _mm512_add_ps(a, b); }
+    static inline vec sub(vec a, vec b) { return _mm512_sub_ps(a, b); }
+    static inline vec mul(vec a, vec b) { return _mm512_mul_ps(a, b); }
+    static inline vec mul_add(vec a, vec b, vec c) { return _mm512_fmadd_ps(a, b, c); }
+    static inline vec mul_sub(vec a, vec b, vec c) { return _mm512_fmsub_ps(a, b, c); }
+#else
+    typedef __m512d vec;
+    static const long width = 8;
+    static inline vec load(const double *p) { return _mm512_loadu_pd(p); }
+    static inline void store(double *p, vec a) { _mm512_storeu_pd(p, a); }
+    static inline vec add(vec a, vec b) { return _mm512_add_pd(a, b); }
+    static inline vec sub(vec a, vec b) { return _mm512_sub_pd(a, b); }
+    static inline vec mul(vec a, vec b) { return _mm512_mul_pd(a, b); }
+    static inline vec mul_add(vec a, vec b, vec c) { return _mm512_fmadd_pd(a, b, c); }
+    static inline vec mul_sub(vec a, vec b, vec c) { return _mm512_fmsub_pd(a, b, c); }
+#endif
+};
+#include "chiller_fft_kernels.h"
+}
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+#endif // CHILLER_SIMD_X86
+
+#if CHILLER_SIMD_NEON
+namespace chiller_neon {
+struct fft_ops {
+#ifdef CHILLER_FLOAT32
+    typedef float32x4_t vec;
+    static const long width = 4;
+    static inline vec load(const float *p) { return vld1q_f32(p); }
+    static inline void store(float *p, vec a) { vst1q_f32(p, a); }
+    static inline vec add(vec a, vec b) { return vaddq_f32(a, b); }
+    static inline vec sub(vec a, vec b) { return vsubq_f32(a, b); }
+    static inline vec mul(vec a, vec b) { return vmulq_f32(a, b); }
+    static inline vec mul_add(vec a, vec b, vec c) { return vfmaq_f32(c, a, b); }
+    static inline vec mul_sub(vec a, vec b, vec c) { return vsubq_f32(vmulq_f32(a, b), c); }
+#else
+    typedef float64x2_t vec;
+    static const long width = 2;
+    static inline vec load(const double *p) { return vld1q_f64(p); }
+    static inline void store(double *p, vec a) { vst1q_f64(p, a); }
+    static inline vec add(vec a, vec b) { return vaddq_f64(a, b); }
+    static inline vec sub(vec a, vec b) { return vsubq_f64(a, b); }
+    static inline vec mul(vec a, vec b) { return vmulq_f64(a, b); }
+    static inline vec mul_add(vec a, vec b, vec c) { return vfmaq_f64(c, a, b); }
+    static inline vec mul_sub(vec a, vec b, vec c) { return vsubq_f64(vmulq_f64(a, b), c); }
+#endif
+};
+#include "chiller_fft_kernels.h"
+}
+#endif // CHILLER_SIMD_NEON
+
+t_chiller_fft_kernel chiller_fft_kernel = chiller_scalar::fft_core;
+const char *chiller_fft_kernel_name = "scalar";
+
+t_chiller_real chiller_phasor_re[CHILLER_PHASOR_TABLE_SIZE];
+t_chiller_real chiller_phasor_im[CHILLER_PHASOR_TABLE_SIZE];
+
+void chiller_rfft(t_chiller_real *re, t_chiller_real *im, std::complex<t_chiller_real> *spectrum, const t_chiller_fft_plan *plan) {
+    // Real FFT of n samples via one complex FFT of n/2 points, on input
+    // already packed by chiller_pack_frame; the result is untangled into
+    // the n/2 + 1 bins
+    long half = plan->half_size;
+    
+    chiller_fft_kernel(re, im, plan);
+    
+    for (long k = 0; k <= half; k++) {
+        long a = k % half;
+        long b = (half - k) % half;
+        std::complex<t_chiller_real> zk(re[a], im[a]);
+        std::complex<t_chiller_real> zc(re[b], -im[b]);
+        std::complex<t_chiller_real> even = (zk + zc) * (t_chiller_real)0.5;
+        std::complex<t_chiller_real> odd = (zk - zc) * std::complex<t_chiller_real>(0.0, -0.5);
+        spectrum[k] = even + plan->real_twiddles[k] * odd;
+    }
+}
+
+void chiller_irfft(const std::vector<std::complex<t_chiller_real>>& spectrum, std::vector<t_chiller_real>& work_re, std::vector<t_chiller_real>& work_im, std::vector<t_chiller_real>& output, const t_chiller_fft_plan *plan) {
+    // Inverse of chiller_rfft: rebuild the packed half-size spectrum from the
+    // fft_size/2 + 1 stored bins (the rest follow from Hermitian symmetry)
+    long half = plan->half_size;
+    t_chiller_real *re = work_re.data();
+    t_chiller_real *im = work_im.data();
+    
+    for (long k = 0; k < half; k++) {
+        std::complex<t_chiller_real> xk = spectrum[k];
+        std::complex<t_chiller_real> xc = std::conj(spectrum[half - k]);
+        std::complex<t_chiller_real> even = (xk + xc) * (t_chiller_real)0.5;
+        std::complex<t_chiller_real> odd = (xk - xc) * std::conj(plan->real_twiddles[k]) * (t_chiller_real)0.5;
+        std::complex<t_chiller_real> z = even + std::complex<t_chiller_real>(0.0, 1.0) * odd;
+        long r = plan->bitrev[k];
+        re[r] = z.real();
+        im[r] = z.imag();
+    }
+    
+    // Inverse transform = forward kernel with real and imaginary parts swapped
+    chiller_fft_kernel(im, re, plan);
+    
+    t_chiller_real scale = (t_chiller_real)1.0 / half;
+    for (long i = 0; i < half; i++) {
+        output[2 * i] = re[i] * scale;
+        output[2 * i + 1] = im[i] * scale;
+    }
+}
+
+void chiller_generate_window(std::vector<t_chiller_real>& window, long size) {
+    for (long i = 0; i < size; i++) {
+        window[i] = 0.5 * (1.0 - cos(2.0 * M_PI * i / (size - 1)));  // Hann window
+    }
+}
+
+void chiller_rng_seed(t_chiller_rng *rng, uint64_t seed) {
+    // Expand the seed into independent lane states with splitmix64
+    uint64_t z = seed;
+    for (long lane = 0; lane < CHILLER_RNG_LANES; lane++) {
+        uint32_t words[4];
+        for (long w = 0; w < 4; w += 2) {
+            z += 0x9e3779b97f4a7c15ULL;
+            uint64_t v = z;
+            v = (v ^ (v >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            v = (v ^ (v >> 27)) * 0x94d049bb133111ebULL;
+            v ^= v >> 31;
+            words[w] = (uint32_t)v;
+            words[w + 1] = (uint32_t)(v >> 32);
+        }
+        // An all-zero state would stick at zero
+        if ((words[0] | words[1] | words[2] | words[3]) == 0) words[0] = 1;
+        rng->s0[lane] = words[0];
+        rng->s1[lane] = words[1];
+        rng->s2[lane] = words[2];
+        rng->s3[lane] = words[3];
+    }
+}
+
+void chiller_rng_fill(t_chiller_rng *rng, t_chiller_real *out, long count) {
+    // Uniform values in [-1, 1) with 24-bit resolution. Writes count rounded up
+    // to a whole number of lane groups, so out must be padded accordingly.
+    const t_chiller_real scale = (t_chiller_real)(1.0 / 8388608.0);
+    uint32_t s0[CHILLER_RNG_LANES], s1[CHILLER_RNG_LANES], s2[CHILLER_RNG_LANES], s3[CHILLER_RNG_LANES];
+    
+    // Work on local copies so the lane loop stays in registers
+    for (long lane = 0; lane < CHILLER_RNG_LANES; lane++) {
+        s0[lane] = rng->s0[lane];
+        s1[lane] = rng->s1[lane];
+        s2[lane] = rng->s2[lane];
+        s3[lane] = rng->s3[lane];
+    }
+    
+    for (long i = 0; i < count; i += CHILLER_RNG_LANES) {
+        for (long lane = 0; lane < CHILLER_RNG_LANES; lane++) {
+            uint32_t sum = s0[lane] + s3[lane];
+            uint32_t result = ((sum << 7) | (sum >> 25)) + s0[lane];
+            uint32_t t = s1[lane] << 9;
+            
+            s2[lane] ^= s0[lane];
+            s3[lane] ^= s1[lane];
+            s1[lane] ^= s2[lane];
+            s0[lane] ^= s3[lane];
+            s2[lane] ^= t;
+            s3[lane] = (s3[lane] << 11) | (s3[lane] >> 21);
+            
+            out[i + lane] = (t_chiller_real)((int32_t)result >> 8) * scale;
+        }
+    }
+    
+    for (long lane = 0; lane < CHILLER_RNG_LANES; lane++) {
+        rng->s0[lane] = s0[lane];
+        rng->s1[lane] = s1[lane];
+        rng->s2[lane] = s2[lane];
+        rng->s3[lane] = s3[lane];
+    }
+}
+
+void chiller_phasor_table_init(void) {
+    for (long k = 0; k < CHILLER_PHASOR_TABLE_SIZE; k++) {
+        double angle = 2.0 * M_PI * k / CHILLER_PHASOR_TABLE_SIZE;
+        chiller_phasor_re[k] = (t_chiller_real)cos(angle);
+        chiller_phasor_im[k] = (t_chiller_real)sin(angle);
+    }
+}
+
+void chiller_grain_advance(t_chiller_real *advance, const t_chiller_real *magnitude, long fft_size, double elapsed) {
+    // Advancing a grain by elapsed samples turns a partial of f bins by
+    // f * elapsed / fft_size cycles. Only the fraction matters, and it is
+    // taken in double before the (possibly float) offsets are updated.
+    const long num_bins = fft_size / 2 + 1;
+    const double cycles_per_bin = elapsed / fft_size;
+    long start = 0;
+    while (start < num_bins) {
+        // Climb to the next peak, then down to the lowest bin after it
+        long peak = start;
+        while (peak + 1 < num_bins && magnitude[peak + 1] > magnitude[peak]) {
+            peak++;
+        }
+        long end = peak;
+        while (end + 1 < num_bins && magnitude[end + 1] <= magnitude[end]) {
+            end++;
+        }
+        
+        // Offset of the peak from its bin, from the ratio r of its larger
+        // neighbour to it: d = (2r - 1) / (r + 1) for the Hann window's main
+        // lobe. The neighbours of the end bins mirror around DC and Nyquist.
+        double left = magnitude[peak > 0 ? peak - 1 : 1];
+        double right = magnitude[peak < num_bins - 1 ? peak + 1 : peak - 1];
+        double ratio = std::max(left, right) / ((double)magnitude[peak] + 1e-30);
+        double offset = std::max((2.0 * ratio - 1.0) / (ratio + 1.0), -0.5);
+        double cycles = (peak + (right >= left ? offset : -offset)) * cycles_per_bin;
+        t_chiller_real step = (t_chiller_real)(cycles - (double)(int64_t)cycles);
+        
+        for (long j = start; j <= end; j++) {
+            t_chiller_real a = advance[j] + step;
+            advance[j] = a - (t_chiller_real)(int32_t)a;
+        }
+        start = end + 1;
+    }
+}
+
+void chiller_grain_bins(std::complex<t_chiller_real> *bins, const t_chiller_real *magnitude, const t_chiller_real *phasor_re, const t_chiller_real *phasor_im,
+                        const t_chiller_real *advance, const t_chiller_real *phase_noise, const t_chiller_real *amp_noise, long fft_size,
+                        double phase_randomness, double amplitude_variation, double delay) {
+    // Phase offset of noise * pi * phase_randomness, expressed in phasor
+    // table steps (half a table spans pi). The running advance turns the bin
+    // back by advance[j] cycles (advancing the waveform in time), and the
+    // sub-sample onset delay is a linear phase of 2*pi * j * delay / fft_size
+    // on bin j (the transforms use the e^(+i) convention forward), which
+    // delays the grain waveform by that many samples; both are folded into
+    // the same rotation. Twice the table size is added so the rounded index
+    // stays positive before masking.
+    const long table_mask = CHILLER_PHASOR_TABLE_SIZE - 1;
+    const long num_bins = fft_size / 2 + 1;
+    t_chiller_real index_scale = (t_chiller_real)(0.5 * CHILLER_PHASOR_TABLE_SIZE * phase_randomness);
+    t_chiller_real index_offset = (t_chiller_real)(2 * CHILLER_PHASOR_TABLE_SIZE + 0.5);
+    t_chiller_real advance_scale = (t_chiller_real)CHILLER_PHASOR_TABLE_SIZE;
+    t_chiller_real delay_step = (t_chiller_real)(delay * CHILLER_PHASOR_TABLE_SIZE / fft_size);
+    t_chiller_real amp_scale = (t_chiller_real)amplitude_variation;
+    
+    for (long j = 0; j < num_bins; j++) {
+        // Apply amplitude variation
+        t_chiller_real level = magnitude[j] * (1 + amp_noise[j] * amp_scale);
+        
+        // Add phase randomization, the advance and the onset delay by
+        // rotating the bin's phasor
+        long index = (long)(phase_noise[j] * index_scale + index_offset - advance[j] * advance_scale + j * delay_step) & table_mask;
+        t_chiller_real rot_re = chiller_phasor_re[index];
+        t_chiller_real rot_im = chiller_phasor_im[index];
+        t_chiller_real re = phasor_re[j] * rot_re - phasor_im[j] * rot_im;
+        t_chiller_real im = phasor_re[j] * rot_im + phasor_im[j] * rot_re;
+        
+        bins[j] = std::complex<t_chiller_real>(level * re, level * im);
+    }
+    
+    // DC and Nyquist bins of a real signal carry no imaginary part
+    bins[0] = bins[0].real();
+    bins[num_bins - 1] = bins[num_bins - 1].real();
+}
+
+void chiller_grain_overlap_add(const t_chiller_real *grain, const t_chiller_real *window, long fft_size, double delay, long start,
+                               t_chiller_real *ola_a, t_chiller_real gain_a, t_chiller_real *ola_b, t_chiller_real gain_b) {
+    // The waveform was delayed by the phase rotation in chiller_grain_bins
+    // (circularly, but the Hann window is zero at both ends); shift the
+    // window by the same sub-sample delay (linear interpolation between
+    // neighbouring points)
+    const long mask = fft_size - 1;
+    t_chiller_real frac = (t_chiller_real)delay;
+    t_chiller_real previous = 0.0;
+    if (ola_b) {
+        for (long j = 0; j < fft_size; j++) {
+            t_chiller_real w = window[j] + (previous - window[j]) * frac;
+            t_chiller_real sample = grain[j] * w;
+            long k = (start + j) & mask;
+            previous = window[j];
+            ola_a[k] += sample * gain_a;
+            ola_b[k] += sample * gain_b;
+        }
+    } else {
+        for (long j = 0; j < fft_size; j++) {
+            t_chiller_real w = window[j] + (previous - window[j]) * frac;
+            long k = (start + j) & mask;
+            previous = window[j];
+            ola_a[k] += grain[j] * w * gain_a;
+        }
+    }
+}
+
+void chiller_overlap_sums(const t_chiller_fft_plan *plan, double grain_spacing, double *coherent, double *incoherent) {
+    // The envelope is the sum of w^2 shifted by every onset. Its mean square
+    // is the sum of the autocorrelation of w^2 at lags m * grain_spacing over
+    // all m, divided by the spacing, when the grains add in amplitude; only
+    // the m = 0 term (the sum of w^4) remains when they add in power.
+    // Fractional lags interpolate between neighbouring integer lags.
+    const long size = plan->fft_size;
+    const t_chiller_real *window = plan->window.data();
+    auto correlation = [&](long lag) {
+        double sum = 0.0;
+        for (long i = 0; i + lag < size; i++) {
+            double a = (double)window[i] * window[i];
+            double b = (double)window[i + lag] * window[i + lag];
+            sum += a * b;
+        }
+        return sum;
+    };
+    
+    double lags = 0.0;
+    for (long m = 1; m * grain_spacing < size; m++) {
+        double lag = m * grain_spacing;
+        long whole = (long)lag;
+        double frac = lag - whole;
+        lags += correlation(whole) * (1.0 - frac) + (frac > 0 ? correlation(whole + 1) * frac : 0.0);
+    }
+    *incoherent = plan->window_power / grain_spacing;
+    *coherent = (plan->window_power + 2.0 * lags) / grain_spacing;
+}
+
+double chiller_overlap_level(double coherent, double incoherent, double phase_randomness, double amplitude_variation) {
+    // Phase noise uniform over +-pi * phase_randomness keeps sin(x) / x of a
+    // bin's mean phasor; amplitude noise uniform over +-amplitude_variation
+    // adds amplitude_variation^2 / 3 to its mean power
+    double x = M_PI * phase_randomness;
+    double kept = x > 0 ? sin(x) / x : 1.0;
+    kept *= kept;
+    double noise_power = 1.0 + amplitude_variation * amplitude_variation / 3.0 - kept;
+    return sqrt(kept * coherent + noise_power * incoherent);
+}
+
+static std::mutex chiller_fft_plan_mutex;
+static std::map<long, t_chiller_fft_plan *> chiller_fft_plans;
+
+t_chiller_fft_plan *chiller_fft_plan_acquire(long fft_size) {
+    std::lock_guard<std::mutex> lock(chiller_fft_plan_mutex);
+    
+    auto found = chiller_fft_plans.find(fft_size);
+    if (found != chiller_fft_plans.end()) {
+        found->second->refcount++;
+        return found->second;
+    }
+    
+    t_chiller_fft_plan *plan = new t_chiller_fft_plan;
+    plan->fft_size = fft_size;
+    plan->half_size = fft_size / 2;
+    plan->refcount = 1;
+    
+    long n = plan->half_size;
+    long log2n = 0;
+    while ((1L << log2n) < n) log2n++;
+    plan->radix2_first = (log2n & 1) != 0;
+    
+    // Radix-4 stage twiddles, evaluated directly (no recurrence) so large
+    // sizes don't drift; stored split re/im and contiguous per stage
+    for (long q = plan->radix2_first ? 2 : 1; q < n; q *= 4) {
+        size_t offset = plan->stage_twiddles.size();
+        plan->stage_twiddles.resize(offset + 4 * q);
+        t_chiller_real *w = plan->stage_twiddles.data() + offset;
+        for (long j = 0; j < q; j++) {
+            double angle = 2.0 * M_PI * j / (4 * q);
+            w[j] = cos(angle);
+            w[q + j] = sin(angle);
+            w[2 * q + j] = cos(2.0 * angle);
+            w[3 * q + j] = sin(2.0 * angle);
+        }
+    }
+    
+    plan->real_twiddles.resize(n + 1);
+    for (long k = 0; k <= n; k++) {
+        plan->real_twiddles[k] = std::complex<t_chiller_real>(std::polar(1.0, 2.0 * M_PI * k / fft_size));
+    }
+    
+    // Bit-reverse permutation
+    plan->bitrev.resize(n);
+    for (long i = 0; i < n; i++) {
+        long r = 0;
+        for (long b = 0; b < log2n; b++) {
+            r |= ((i >> b) & 1) << (log2n - 1 - b);
+        }
+        plan->bitrev[i] = r;
+    }
+    
+    plan->window.resize(fft_size);
+    chiller_generate_window(plan->window, fft_size);
+    
+    plan->window_power = 0.0;
+    for (long i = 0; i < fft_size; i++) {
+        double w2 = (double)plan->window[i] * plan->window[i];
+        plan->window_power += w2 * w2;
+    }
+    
+    chiller_fft_plans[fft_size] = plan;
+    return plan;
+}
+
+long chiller_fft_kernels(t_chiller_fft_kernel_info *list) {
+    long count = 0;
+    list[count++] = { "scalar", chiller_scalar::fft_core };
+#if CHILLER_SIMD_X86
+    bool has_avx2 = false;
+    bool has_avx512 = false;
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] >= 7) {
+        __cpuid(info, 1);
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        bool fma = (info[2] & (1 << 12)) != 0;
+        unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+        __cpuidex(info, 7, 0);
+        has_avx2 = fma && (info[1] & (1 << 5)) && (xcr0 & 0x06) == 0x06;
+        has_avx512 = (info[1] & (1 << 16)) && (xcr0 & 0xe6) == 0xe6;
+    }
+#else
+    __builtin_cpu_init();
+    has_avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    has_avx512 = __builtin_cpu_supports("avx512f");
+#endif
+    list[count++] = { "sse2", chiller_sse2::fft_core };
+    if (has_avx2) list[count++] = { "avx2", chiller_avx2::fft_core };
+    if (has_avx512) list[count++] = { "avx512", chiller_avx512::fft_core };
+#elif CHILLER_SIMD_NEON
+    list[count++] = { "neon", chiller_neon::fft_core };
+#endif
+    return count;
+}
+
+void chiller_fft_select_kernel(void) {
+    t_chiller_fft_kernel_info kernels[CHILLER_FFT_MAX_KERNELS];
+    long count = chiller_fft_kernels(kernels);
+    chiller_fft_kernel = kernels[count - 1].kernel;
+    chiller_fft_kernel_name = kernels[count - 1].name;
+}
+
+void chiller_fft_plan_release(t_chiller_fft_plan *plan) {
+    if (!plan) return;
+    
+    std::lock_guard<std::mutex> lock(chiller_fft_plan_mutex);
+    
+    if (--plan->refcount == 0) {
+        chiller_fft_plans.erase(plan->fft_size);
+        delete plan;
+    }
+}
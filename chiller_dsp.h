@@ -0,0 +1,139 @@
+// Signal processing core of chiller~: FFT plans and kernels, the real
+// transform pair, the grain noise generator, the phasor table and grain
+// construction.
+//
+// Nothing here depends on the Max SDK, so the same sources build into the
+// external and into the tests and benchmarks under tests/. Build everything
+// with CHILLER_FLOAT32 defined for the single-precision engine.
+
+#pragma once
+
+#include <complex>
+#include <vector>
+#include <cstdint>
+
+// Sample type of the synthesis engine (spectrum, window, FFT and overlap-add).
+// Build with CHILLER_FLOAT32 defined for the single-precision engine: half the
+// cache footprint and twice the SIMD width. The outlets are always 64-bit.
+#ifdef CHILLER_FLOAT32
+typedef float t_chiller_real;
+#else
+typedef double t_chiller_real;
+#endif
+
+// Precomputed, read-only tables for one FFT size. Plans are shared by every
+// chiller~ instance with the same fft_size through a refcounted registry.
+typedef struct _chiller_fft_plan {
+    long fft_size;      // Real transform size
+    long half_size;     // Size of the complex transform (fft_size / 2)
+    long refcount;      // Instances holding this plan (guarded by the registry mutex)
+    
+    bool radix2_first;                                 // half_size is an odd power of 2
+    std::vector<t_chiller_real> stage_twiddles;                // Per radix-4 stage: w1 re, w1 im, w2 re, w2 im
+    std::vector<std::complex<t_chiller_real>> real_twiddles;   // e^(2*pi*i*k / fft_size), k <= half_size
+    std::vector<long> bitrev;                                  // Bit-reversed index of each point
+    std::vector<t_chiller_real> window;                        // Hann window of fft_size points
+    double window_power;                                       // Sum of window^4 (power of the analysis x synthesis envelope)
+} t_chiller_fft_plan;
+
+// SIMD FFT kernels. chiller_fft_kernels.h is compiled once per instruction set
+// (in chiller_dsp.cpp) inside a namespace providing `fft_ops`; the widest
+// kernel the CPU supports is picked at load time by chiller_fft_select_kernel().
+// A kernel transforms half_size points in place, from bit-reversed input.
+typedef void (*t_chiller_fft_kernel)(t_chiller_real *re, t_chiller_real *im, const t_chiller_fft_plan *plan);
+
+typedef struct _chiller_fft_kernel_info {
+    const char *name;
+    t_chiller_fft_kernel kernel;
+} t_chiller_fft_kernel_info;
+
+#define CHILLER_FFT_MAX_KERNELS 4
+
+// Kernel used by chiller_rfft / chiller_irfft, and its name
+extern t_chiller_fft_kernel chiller_fft_kernel;
+extern const char *chiller_fft_kernel_name;
+
+// Fill list (CHILLER_FFT_MAX_KERNELS entries) with the kernels this CPU can
+// run, from the scalar one up to the widest; returns how many there are
+long chiller_fft_kernels(t_chiller_fft_kernel_info *list);
+void chiller_fft_select_kernel(void);
+
+// Plans are refcounted per fft_size (a power of two, at least 4)
+t_chiller_fft_plan *chiller_fft_plan_acquire(long fft_size);
+void chiller_fft_plan_release(t_chiller_fft_plan *plan);
+
+// Forward transform of fft_size real samples, packed as even samples in re
+// and odd samples in im, in bit-reversed order (re and im are overwritten),
+// into fft_size/2 + 1 bins
+void chiller_rfft(t_chiller_real *re, t_chiller_real *im, std::complex<t_chiller_real> *spectrum, const t_chiller_fft_plan *plan);
+
+// Inverse of chiller_rfft, scaled by 1 / half_size; the work arrays hold half_size points
+void chiller_irfft(const std::vector<std::complex<t_chiller_real>>& spectrum, std::vector<t_chiller_real>& work_re, std::vector<t_chiller_real>& work_im, std::vector<t_chiller_real>& output, const t_chiller_fft_plan *plan);
+
+void chiller_generate_window(std::vector<t_chiller_real>& window, long size);
+
+// Multi-lane xoshiro128++ generator for grain noise. The lanes are stored
+// structure-of-arrays and advanced together, so bulk fills vectorize.
+#define CHILLER_RNG_LANES 8
+
+typedef struct _chiller_rng {
+    uint32_t s0[CHILLER_RNG_LANES];
+    uint32_t s1[CHILLER_RNG_LANES];
+    uint32_t s2[CHILLER_RNG_LANES];
+    uint32_t s3[CHILLER_RNG_LANES];
+} t_chiller_rng;
+
+// Seed every lane from one value (through splitmix64)
+void chiller_rng_seed(t_chiller_rng *rng, uint64_t seed);
+// Fill out with count values uniform in [-1, 1); out must have room for count
+// rounded up to a whole number of lanes
+void chiller_rng_fill(t_chiller_rng *rng, t_chiller_real *out, long count);
+
+// Unit phasors e^(2*pi*i*k / size) used to rotate bins by a random phase
+// offset without calling sin/cos. Rounding the offset to the nearest entry
+// bounds the phase error by pi / size (7.7e-4 rad, about -62 dB).
+#define CHILLER_PHASOR_TABLE_SIZE 4096
+
+extern t_chiller_real chiller_phasor_re[CHILLER_PHASOR_TABLE_SIZE];
+extern t_chiller_real chiller_phasor_im[CHILLER_PHASOR_TABLE_SIZE];
+
+// Fill the phasor table; called once when the class loads
+void chiller_phasor_table_init(void);
+
+// Grain construction, shared by the perform routine and the benchmarks. The
+// noise arrays hold one value in [-1, 1) per bin, from chiller_rng_fill.
+
+// Advance each bin's running phase offset (in cycles, kept in [0, 1)) by
+// elapsed samples, the time since the previous grain's onset. A bin turns at
+// the frequency of the spectral peak it belongs to: bins are grouped around
+// each magnitude peak up to the lowest bin before the next one, and the peak
+// frequency is interpolated from its neighbours (exact for a Hann-windowed
+// sinusoid). A partial's bins then turn together, so successive grains
+// continue it instead of repeating it, and the window stays where it is.
+void chiller_grain_advance(t_chiller_real *advance, const t_chiller_real *magnitude, long fft_size, double elapsed);
+
+// Bins of one grain from a spectrum's magnitudes and unit phasors: magnitude j
+// is scaled by 1 + amp_noise[j] * amplitude_variation and phasor j rotated by
+// phase_noise[j] * pi * phase_randomness, back by the running offset of
+// advance[j] cycles, and by the linear phase that delays the waveform by delay
+// samples (0 <= delay < 1). Writes fft_size/2 + 1 bins.
+void chiller_grain_bins(std::complex<t_chiller_real> *bins, const t_chiller_real *magnitude, const t_chiller_real *phasor_re, const t_chiller_real *phasor_im,
+                        const t_chiller_real *advance, const t_chiller_real *phase_noise, const t_chiller_real *amp_noise, long fft_size,
+                        double phase_randomness, double amplitude_variation, double delay);
+
+// Window a grain from chiller_irfft, shifted by the same delay, and add it
+// times gain_a into the circular buffer ola_a (and times gain_b into ola_b,
+// unless NULL) of fft_size points, starting at start
+void chiller_grain_overlap_add(const t_chiller_real *grain, const t_chiller_real *window, long fft_size, double delay, long start,
+                               t_chiller_real *ola_a, t_chiller_real gain_a, t_chiller_real *ola_b, t_chiller_real gain_b);
+
+// Mean square of the w^2 envelope of grains overlapped every grain_spacing
+// samples, when their bins add in amplitude (coherent) and in power
+// (incoherent), relative to a single grain's bins
+void chiller_overlap_sums(const t_chiller_fft_plan *plan, double grain_spacing, double *coherent, double *incoherent);
+
+// Output level of overlapped grains relative to a single grain's bins. The
+// phase noise leaves (sin(x) / x)^2, x = pi * phase_randomness, of each bin's
+// power coherent from grain to grain; the rest, and the power the amplitude
+// noise adds, sums incoherently.
+double chiller_overlap_level(double coherent, double incoherent, double phase_randomness, double amplitude_variation);
@@ -0,0 +1,111 @@
+// Radix-4 decimation-in-time FFT core on split real/imaginary arrays.
+//
+// This file is included several times by chiller_dsp.cpp, once per instruction
+// set, inside a namespace that first defines `fft_ops` (vector type, width,
+// load/store and arithmetic). Each inclusion compiles its own fft_core() with
+// the target options in effect at that point, so there is no include guard.
+//
+// Input must already be in bit-reversed order (see t_chiller_fft_plan::bitrev).
+// The transform uses the e^(+2*pi*i*k/n) convention of the plan twiddles; the
+// inverse is obtained by calling fft_core() with the real and imaginary
+// arrays swapped.
+
+static void fft_core(t_chiller_real *re, t_chiller_real *im, const t_chiller_fft_plan *plan) {
+    typedef fft_ops::vec vec;
+    const long width = fft_ops::width;
+    long n = plan->half_size;
+    long len = 1;
+
+    // Odd power of two: one radix-2 stage first, with unit twiddles
+    if (plan->radix2_first) {
+        for (long i = 0; i < n; i += 2) {
+            t_chiller_real ar = re[i], ai = im[i];
+            t_chiller_real br = re[i + 1], bi = im[i + 1];
+            re[i] = ar + br;
+            im[i] = ai + bi;
+            re[i + 1] = ar - br;
+            im[i + 1] = ai - bi;
+        }
+        len = 2;
+    }
+
+    // Radix-4 stages: each merges four blocks of length q into one of 4q,
+    // i.e. two radix-2 stages with twiddles w2 = w1^2 and w1 = e^(2*pi*i*j / 4q)
+    const t_chiller_real *tw = plan->stage_twiddles.data();
+    for (; len < n; len *= 4) {
+        long q = len;
+        const t_chiller_real *w1r = tw;
+        const t_chiller_real *w1i = tw + q;
+        const t_chiller_real *w2r = tw + 2 * q;
+        const t_chiller_real *w2i = tw + 3 * q;
+        tw += 4 * q;
+
+        for (long i = 0; i < n; i += 4 * q) {
+            t_chiller_real *r0 = re + i, *r1 = r0 + q, *r2 = r1 + q, *r3 = r2 + q;
+            t_chiller_real *i0 = im + i, *i1 = i0 + q, *i2 = i1 + q, *i3 = i2 + q;
+            long j = 0;
+
+            for (; j + width <= q; j += width) {
+                vec wr1 = fft_ops::load(w1r + j), wi1 = fft_ops::load(w1i + j);
+                vec wr2 = fft_ops::load(w2r + j), wi2 = fft_ops::load(w2i + j);
+                vec a0r = fft_ops::load(r0 + j), a0i = fft_ops::load(i0 + j);
+                vec a1r = fft_ops::load(r1 + j), a1i = fft_ops::load(i1 + j);
+                vec a2r = fft_ops::load(r2 + j), a2i = fft_ops::load(i2 + j);
+                vec a3r = fft_ops::load(r3 + j), a3i = fft_ops::load(i3 + j);
+
+                // First radix-2 layer: b = a * w2
+                vec b1r = fft_ops::mul_sub(a1r, wr2, fft_ops::mul(a1i, wi2));
+                vec b1i = fft_ops::mul_add(a1r, wi2, fft_ops::mul(a1i, wr2));
+                vec b3r = fft_ops::mul_sub(a3r, wr2, fft_ops::mul(a3i, wi2));
+                vec b3i = fft_ops::mul_add(a3r, wi2, fft_ops::mul(a3i, wr2));
+
+                vec u0r = fft_ops::add(a0r, b1r), u0i = fft_ops::add(a0i, b1i);
+                vec u1r = fft_ops::sub(a0r, b1r), u1i = fft_ops::sub(a0i, b1i);
+                vec u2r = fft_ops::add(a2r, b3r), u2i = fft_ops::add(a2i, b3i);
+                vec u3r = fft_ops::sub(a2r, b3r), u3i = fft_ops::sub(a2i, b3i);
+
+                // Second radix-2 layer: c = u * w1 (the odd pair also picks up a factor of i)
+                vec c2r = fft_ops::mul_sub(u2r, wr1, fft_ops::mul(u2i, wi1));
+                vec c2i = fft_ops::mul_add(u2r, wi1, fft_ops::mul(u2i, wr1));
+                vec c3r = fft_ops::mul_sub(u3r, wr1, fft_ops::mul(u3i, wi1));
+                vec c3i = fft_ops::mul_add(u3r, wi1, fft_ops::mul(u3i, wr1));
+
+                fft_ops::store(r0 + j, fft_ops::add(u0r, c2r));
+                fft_ops::store(i0 + j, fft_ops::add(u0i, c2i));
+                fft_ops::store(r2 + j, fft_ops::sub(u0r, c2r));
+                fft_ops::store(i2 + j, fft_ops::sub(u0i, c2i));
+                fft_ops::store(r1 + j, fft_ops::sub(u1r, c3i));
+                fft_ops::store(i1 + j, fft_ops::add(u1i, c3r));
+                fft_ops::store(r3 + j, fft_ops::add(u1r, c3i));
+                fft_ops::store(i3 + j, fft_ops::sub(u1i, c3r));
+            }
+
+            // Stages narrower than the vector width
+            for (; j < q; j++) {
+                t_chiller_real b1r = r1[j] * w2r[j] - i1[j] * w2i[j];
+                t_chiller_real b1i = r1[j] * w2i[j] + i1[j] * w2r[j];
+                t_chiller_real b3r = r3[j] * w2r[j] - i3[j] * w2i[j];
+                t_chiller_real b3i = r3[j] * w2i[j] + i3[j] * w2r[j];
+
+                t_chiller_real u0r = r0[j] + b1r, u0i = i0[j] + b1i;
+                t_chiller_real u1r = r0[j] - b1r, u1i = i0[j] - b1i;
+                t_chiller_real u2r = r2[j] + b3r, u2i = i2[j] + b3i;
+                t_chiller_real u3r = r2[j] - b3r, u3i = i2[j] - b3i;
+
+                t_chiller_real c2r = u2r * w1r[j] - u2i * w1i[j];
+                t_chiller_real c2i = u2r * w1i[j] + u2i * w1r[j];
+                t_chiller_real c3r = u3r * w1r[j] - u3i * w1i[j];
+                t_chiller_real c3i = u3r * w1i[j] + u3i * w1r[j];
+
+                r0[j] = u0r + c2r;
+                i0[j] = u0i + c2i;
+                r2[j] = u0r - c2r;
+                i2[j] = u0i - c2i;
+                r1[j] = u1r - c3i;
+                i1[j] = u1i + c3r;
+                r3[j] = u1r + c3i;
+                i3[j] = u1i - c3r;
+            }
+        }
+    }
+}
@@ -0,0 +1,56 @@
+// Helpers shared by the chiller_dsp tests and benchmarks.
+//
+// Tests print one line per check and return non-zero from main if any
+// failed; benchmarks print a table and always succeed.
+
+#pragma once
+
+#include "chiller_dsp.h"
+
+#include <chrono>
+#include <cstdio>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+static int chiller_test_failures = 0;
+
+// Report a check: value must be at most limit
+static inline void chiller_test_check(const char *what, double value, double limit) {
+    bool pass = value <= limit;
+    printf("%-4s %-48s %.3g (limit %.3g)\n", pass ? "ok" : "FAIL", what, value, limit);
+    if (!pass) chiller_test_failures++;
+}
+
+// Stores results here so the compiler cannot drop the benchmarked work
+static volatile double chiller_bench_sink;
+
+// Time of one call to fn in seconds: the best of five rounds of at least
+// min_seconds / 5 each, after one warm-up call, so that interruptions by
+// other processes are not counted
+template <typename F>
+double chiller_bench_time(F fn, double min_seconds = 0.2) {
+    typedef std::chrono::steady_clock clock;
+    fn();
+    double best = 0.0;
+    for (long round = 0; round < 5; round++) {
+        long calls = 0;
+        long batch = 1;
+        double elapsed = 0.0;
+        clock::time_point start = clock::now();
+        while (elapsed < min_seconds / 5) {
+            for (long i = 0; i < batch; i++) fn();
+            calls += batch;
+            batch *= 2;
+            elapsed = std::chrono::duration<double>(clock::now() - start).count();
+        }
+        if (round == 0 || elapsed / calls < best) best = elapsed / calls;
+    }
+    return best;
+}
+
+// Engine precision, for the report headers
+static inline const char *chiller_test_precision(void) {
+    return sizeof(t_chiller_real) == sizeof(float) ? "float32" : "double";
+}
@@ -0,0 +1,99 @@
+// FFT benchmark: the original std::complex<double> radix-2 transform against
+// the real transform (chiller_rfft) on each kernel the CPU supports.
+//
+// The original transformed fft_size complex points per frame; chiller_rfft
+// transforms the same fft_size real samples through one complex FFT of half
+// the size. Both timings include copying the input in, since the transforms
+// work in place.
+
+#include "chiller_test.h"
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+// The transform chiller~ used before the split-layout kernels, unchanged
+static void reference_fft(std::vector<std::complex<double>>& data) {
+    // Simple radix-2 Cooley-Tukey FFT implementation
+    long n = data.size();
+    if (n <= 1) return;
+
+    // Bit-reverse reordering
+    for (long i = 1, j = 0; i < n; i++) {
+        long bit = n >> 1;
+        for (; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j) {
+            std::swap(data[i], data[j]);
+        }
+    }
+
+    // FFT computation
+    for (long len = 2; len <= n; len <<= 1) {
+        double ang = 2 * M_PI / len;
+        std::complex<double> wlen(cos(ang), sin(ang));
+        for (long i = 0; i < n; i += len) {
+            std::complex<double> w(1);
+            for (long j = 0; j < len / 2; j++) {
+                std::complex<double> u = data[i + j];
+                std::complex<double> v = data[i + j + len / 2] * w;
+                data[i + j] = u + v;
+                data[i + j + len / 2] = u - v;
+                w *= wlen;
+            }
+        }
+    }
+}
+
+int main(void) {
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<double> dist(-1.0, 1.0);
+    t_chiller_fft_kernel_info kernels[CHILLER_FFT_MAX_KERNELS];
+    long count = chiller_fft_kernels(kernels);
+
+    printf("FFT time per transform in us, %s engine\n", chiller_test_precision());
+    printf("%8s %10s", "size", "reference");
+    for (long k = 0; k < count; k++) printf(" %10s", kernels[k].name);
+    printf(" %10s\n", "speedup");
+
+    for (long fft_size = 512; fft_size <= 8192; fft_size *= 2) {
+        t_chiller_fft_plan *plan = chiller_fft_plan_acquire(fft_size);
+        long half = plan->half_size;
+
+        std::vector<std::complex<double>> source(fft_size), data(fft_size);
+        std::vector<t_chiller_real> packed_re(half), packed_im(half), re(half), im(half);
+        for (long t = 0; t < fft_size; t++) {
+            double v = dist(rng);
+            source[t] = v;
+            if (t & 1) packed_im[plan->bitrev[t / 2]] = (t_chiller_real)v;
+            else packed_re[plan->bitrev[t / 2]] = (t_chiller_real)v;
+        }
+        std::vector<std::complex<t_chiller_real>> bins(half + 1);
+
+        double reference = chiller_bench_time([&] {
+            data = source;
+            reference_fft(data);
+            chiller_bench_sink = data[1].real();
+        });
+        printf("%8ld %10.2f", fft_size, reference * 1e6);
+
+        double fastest = reference;
+        for (long k = 0; k < count; k++) {
+            chiller_fft_kernel = kernels[k].kernel;
+            double seconds = chiller_bench_time([&] {
+                re = packed_re;
+                im = packed_im;
+                chiller_rfft(re.data(), im.data(), bins.data(), plan);
+                chiller_bench_sink = bins[1].real();
+            });
+            printf(" %10.2f", seconds * 1e6);
+            if (seconds < fastest) fastest = seconds;
+        }
+        printf(" %9.1fx\n", reference / fastest);
+
+        chiller_fft_plan_release(plan);
+    }
+    return 0;
+}
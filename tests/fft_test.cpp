@@ -0,0 +1,123 @@
+// Accuracy of the FFT kernels and the real transform pair against a naive DFT.
+//
+// Every kernel the CPU supports is run on random input for each power-of-two
+// size (odd and even, so with and without the leading radix-2 stage). The
+// error is the RMS difference from the DFT relative to the RMS of the DFT,
+// which stays near the rounding error of the engine precision for a correct
+// transform and is of order 1 for a wrong twiddle or permutation.
+
+#include "chiller_test.h"
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+// Relative error limits, a few hundred rounding errors of each precision
+static const double chiller_test_limit = sizeof(t_chiller_real) == sizeof(float) ? 2e-5 : 1e-13;
+
+typedef std::complex<long double> t_exact;
+
+// Naive DFT with the e^(+2*pi*i*k*t / n) convention of the kernels
+static void naive_dft(const std::vector<t_exact>& in, std::vector<t_exact>& out) {
+    long n = (long)in.size();
+    std::vector<t_exact> twiddles(n);
+    for (long t = 0; t < n; t++) {
+        long double angle = 2.0L * M_PI * t / n;
+        twiddles[t] = t_exact(cosl(angle), sinl(angle));
+    }
+    out.assign(n, 0);
+    for (long k = 0; k < n; k++) {
+        t_exact sum = 0;
+        for (long t = 0; t < n; t++) {
+            sum += in[t] * twiddles[(k * t) % n];
+        }
+        out[k] = sum;
+    }
+}
+
+template <typename T>
+static double relative_error(const T *got, const std::vector<t_exact>& want, long count) {
+    long double diff = 0, norm = 0;
+    for (long k = 0; k < count; k++) {
+        t_exact d = t_exact(got[k]) - want[k];
+        diff += std::norm(d);
+        norm += std::norm(want[k]);
+    }
+    return (double)sqrtl(diff / norm);
+}
+
+static void test_kernel(const t_chiller_fft_kernel_info *info, long fft_size, std::mt19937& rng) {
+    std::uniform_real_distribution<double> dist(-1.0, 1.0);
+    t_chiller_fft_plan *plan = chiller_fft_plan_acquire(fft_size);
+    long n = plan->half_size;
+
+    std::vector<t_exact> in(n), want;
+    std::vector<t_chiller_real> re(n), im(n);
+    for (long i = 0; i < n; i++) {
+        t_chiller_real a = (t_chiller_real)dist(rng), b = (t_chiller_real)dist(rng);
+        in[i] = t_exact(a, b);
+        re[plan->bitrev[i]] = a;
+        im[plan->bitrev[i]] = b;
+    }
+    naive_dft(in, want);
+    info->kernel(re.data(), im.data(), plan);
+
+    std::vector<std::complex<t_chiller_real>> got(n);
+    for (long k = 0; k < n; k++) {
+        got[k] = std::complex<t_chiller_real>(re[k], im[k]);
+    }
+    char what[64];
+    snprintf(what, sizeof(what), "%s kernel, %ld points", info->name, n);
+    chiller_test_check(what, relative_error(got.data(), want, n), chiller_test_limit);
+
+    chiller_fft_plan_release(plan);
+}
+
+static void test_real_pair(long fft_size, std::mt19937& rng) {
+    std::uniform_real_distribution<double> dist(-1.0, 1.0);
+    t_chiller_fft_plan *plan = chiller_fft_plan_acquire(fft_size);
+    long half = plan->half_size;
+
+    // Forward: even samples packed as real, odd as imaginary, bit-reversed
+    std::vector<t_exact> in(fft_size), want;
+    std::vector<t_chiller_real> re(half), im(half);
+    for (long t = 0; t < fft_size; t++) {
+        t_chiller_real v = (t_chiller_real)dist(rng);
+        in[t] = v;
+        if (t & 1) im[plan->bitrev[t / 2]] = v;
+        else re[plan->bitrev[t / 2]] = v;
+    }
+    naive_dft(in, want);
+    std::vector<std::complex<t_chiller_real>> bins(half + 1);
+    chiller_rfft(re.data(), im.data(), bins.data(), plan);
+
+    char what[64];
+    snprintf(what, sizeof(what), "rfft (%s), %ld points", chiller_fft_kernel_name, fft_size);
+    chiller_test_check(what, relative_error(bins.data(), want, half + 1), chiller_test_limit);
+
+    // Inverse: back to the samples
+    std::vector<t_chiller_real> out(fft_size);
+    chiller_irfft(bins, re, im, out, plan);
+    snprintf(what, sizeof(what), "irfft round trip (%s), %ld points", chiller_fft_kernel_name, fft_size);
+    chiller_test_check(what, relative_error(out.data(), in, fft_size), chiller_test_limit);
+
+    chiller_fft_plan_release(plan);
+}
+
+int main(void) {
+    std::mt19937 rng(1);
+    t_chiller_fft_kernel_info kernels[CHILLER_FFT_MAX_KERNELS];
+    long count = chiller_fft_kernels(kernels);
+    chiller_fft_select_kernel();
+    printf("FFT accuracy, %s engine\n", chiller_test_precision());
+
+    for (long k = 0; k < count; k++) {
+        for (long fft_size = 8; fft_size <= 8192; fft_size *= 2) {
+            test_kernel(&kernels[k], fft_size, rng);
+        }
+    }
+    for (long fft_size = 8; fft_size <= 8192; fft_size *= 2) {
+        test_real_pair(fft_size, rng);
+    }
+    return chiller_test_failures ? 1 : 0;
+}
@@ -0,0 +1,126 @@
+// Instances per core: the synthesis cost of one chiller~ playing a frozen
+// spectrum, as a number of real-time instances one core could run.
+//
+// One second of 48 kHz audio is rendered the way chiller_perform64 does it,
+// in 64-sample vectors: grains (noise fill, chiller_grain_advance,
+// chiller_grain_bins, chiller_irfft and chiller_grain_overlap_add into both
+// outputs) at the scheduled onsets, then the run written to the 64-bit
+// outlets and cleared. Message handling and captures are not included.
+// Compare the _double and _float32 builds.
+
+#include "chiller_test.h"
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+#define BENCH_SAMPLE_RATE 48000
+#define BENCH_VECTOR_SIZE 64
+
+typedef struct _bench_instance {
+    long fft_size;
+    long num_bins;
+    double grain_spacing;
+    double countdown;
+    long read_pos;
+    t_chiller_fft_plan *plan;
+    t_chiller_rng rng;
+    std::vector<t_chiller_real> magnitude, phasor_re, phasor_im, advance;
+    std::vector<t_chiller_real> phase_noise, amp_noise;
+    std::vector<std::complex<t_chiller_real>> bins;
+    std::vector<t_chiller_real> work_re, work_im, grain;
+    std::vector<t_chiller_real> ola_l, ola_r;
+} t_bench_instance;
+
+static void bench_instance_init(t_bench_instance *x, long fft_size, double overlap) {
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<double> dist(0.0, 1.0);
+    x->fft_size = fft_size;
+    x->num_bins = fft_size / 2 + 1;
+    x->grain_spacing = (long)(fft_size / overlap + 0.5);
+    x->countdown = 0.0;
+    x->read_pos = 0;
+    x->plan = chiller_fft_plan_acquire(fft_size);
+    chiller_rng_seed(&x->rng, 1);
+
+    // A noise-like frozen spectrum; the level does not affect the timing
+    long padded = (x->num_bins + CHILLER_RNG_LANES - 1) / CHILLER_RNG_LANES * CHILLER_RNG_LANES;
+    x->magnitude.resize(x->num_bins);
+    x->phasor_re.resize(x->num_bins);
+    x->phasor_im.resize(x->num_bins);
+    x->advance.assign(x->num_bins, 0);
+    for (long j = 0; j < x->num_bins; j++) {
+        double angle = 2.0 * M_PI * dist(rng);
+        x->magnitude[j] = (t_chiller_real)(dist(rng) / fft_size);
+        x->phasor_re[j] = (t_chiller_real)cos(angle);
+        x->phasor_im[j] = (t_chiller_real)sin(angle);
+    }
+    x->phase_noise.resize(padded);
+    x->amp_noise.resize(padded);
+    x->bins.resize(x->num_bins);
+    x->work_re.resize(x->plan->half_size);
+    x->work_im.resize(x->plan->half_size);
+    x->grain.resize(fft_size);
+    x->ola_l.assign(fft_size, 0);
+    x->ola_r.assign(fft_size, 0);
+}
+
+static void bench_instance_perform(t_bench_instance *x, double *out_l, double *out_r, long sampleframes) {
+    const long mask = x->fft_size - 1;
+    long i = 0;
+    while (i < sampleframes) {
+        while (x->countdown < 1.0) {
+            chiller_rng_fill(&x->rng, x->phase_noise.data(), x->num_bins);
+            chiller_rng_fill(&x->rng, x->amp_noise.data(), x->num_bins);
+            chiller_grain_advance(x->advance.data(), x->magnitude.data(), x->fft_size, x->grain_spacing);
+            chiller_grain_bins(x->bins.data(), x->magnitude.data(), x->phasor_re.data(), x->phasor_im.data(), x->advance.data(),
+                               x->phase_noise.data(), x->amp_noise.data(), x->fft_size, 0.1, 0.1, x->countdown);
+            chiller_irfft(x->bins, x->work_re, x->work_im, x->grain, x->plan);
+            chiller_grain_overlap_add(x->grain.data(), x->plan->window.data(), x->fft_size, x->countdown, x->read_pos,
+                                      x->ola_l.data(), (t_chiller_real)0.8, x->ola_r.data(), 1);
+            x->countdown += x->grain_spacing;
+        }
+        long run = sampleframes - i;
+        if (x->countdown < run) {
+            run = (long)x->countdown;
+        }
+        x->countdown -= run;
+        for (long j = 0; j < run; j++) {
+            long k = (x->read_pos + j) & mask;
+            out_l[i + j] = (double)x->ola_l[k] * 0.1;
+            out_r[i + j] = (double)x->ola_r[k] * 0.1;
+            x->ola_l[k] = 0;
+            x->ola_r[k] = 0;
+        }
+        x->read_pos = (x->read_pos + run) & mask;
+        i += run;
+    }
+}
+
+int main(void) {
+    chiller_fft_select_kernel();
+    chiller_phasor_table_init();
+    printf("Instances per core at %d Hz, %s engine, %s kernel\n", BENCH_SAMPLE_RATE, chiller_test_precision(), chiller_fft_kernel_name);
+    printf("%8s %8s %14s %10s\n", "fft size", "overlap", "us per second", "instances");
+
+    const long fft_sizes[] = { 2048, 4096 };
+    const double overlaps[] = { 4.0, 8.0 };
+    for (long fft_size : fft_sizes) {
+        for (double overlap : overlaps) {
+            t_bench_instance x;
+            bench_instance_init(&x, fft_size, overlap);
+            double out_l[BENCH_VECTOR_SIZE], out_r[BENCH_VECTOR_SIZE];
+
+            double seconds = chiller_bench_time([&] {
+                for (long n = 0; n < BENCH_SAMPLE_RATE; n += BENCH_VECTOR_SIZE) {
+                    bench_instance_perform(&x, out_l, out_r, BENCH_VECTOR_SIZE);
+                }
+                chiller_bench_sink = out_l[0];
+            }, 1.0);
+            printf("%8ld %8.0f %14.0f %10.0f\n", fft_size, overlap, seconds * 1e6, 1.0 / seconds);
+
+            chiller_fft_plan_release(x.plan);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,127 @@
+// Output level across overlap and grain rate settings.
+//
+// A frozen sine spectrum is played the way chiller_perform64 does it (grain
+// advance, bins, inverse FFT and overlap-add at fractional onsets) with the
+// gain chiller_update_gain would set, at overlaps 2, 4 and 8 and rates 1, 1.5
+// (fractional onsets) and 2. The RMS must stay within 1 dB of the reference
+// setting (overlap 4, rate 1), for sines on and between bins, with and
+// without grain noise. Without the advance the repeated grains comb-filter
+// the sine and its level depends on where it falls against the grain spacing.
+
+#include "chiller_test.h"
+
+#include <cmath>
+#include <vector>
+
+#define TEST_SAMPLE_RATE 48000
+#define TEST_FFT_SIZE 2048
+#define TEST_SECONDS 2
+
+// A Hann-windowed sine frame through chiller_rfft, as a capture stores it
+static void capture_sine(const t_chiller_fft_plan *plan, double frequency, std::vector<t_chiller_real>& magnitude,
+                         std::vector<t_chiller_real>& phasor_re, std::vector<t_chiller_real>& phasor_im) {
+    long half = plan->half_size;
+    long num_bins = plan->fft_size / 2 + 1;
+    std::vector<t_chiller_real> re(half), im(half);
+    std::vector<std::complex<t_chiller_real>> bins(num_bins);
+    for (long i = 0; i < half; i++) {
+        double even = sin(2.0 * M_PI * frequency * (2 * i) / TEST_SAMPLE_RATE);
+        double odd = sin(2.0 * M_PI * frequency * (2 * i + 1) / TEST_SAMPLE_RATE);
+        re[plan->bitrev[i]] = (t_chiller_real)(even * plan->window[2 * i]);
+        im[plan->bitrev[i]] = (t_chiller_real)(odd * plan->window[2 * i + 1]);
+    }
+    chiller_rfft(re.data(), im.data(), bins.data(), plan);
+
+    magnitude.resize(num_bins);
+    phasor_re.resize(num_bins);
+    phasor_im.resize(num_bins);
+    for (long j = 0; j < num_bins; j++) {
+        double level = std::abs(bins[j]);
+        magnitude[j] = (t_chiller_real)level;
+        phasor_re[j] = level > 0 ? (t_chiller_real)(bins[j].real() / level) : 1;
+        phasor_im[j] = level > 0 ? (t_chiller_real)(bins[j].imag() / level) : 0;
+    }
+}
+
+// RMS of the output after the first window length, at the given setting
+static double render_rms(const t_chiller_fft_plan *plan, double frequency, double overlap, double rate,
+                         double phase_randomness, double amplitude_variation) {
+    const long fft_size = plan->fft_size;
+    const long num_bins = fft_size / 2 + 1;
+    const long mask = fft_size - 1;
+    const long padded = (num_bins + CHILLER_RNG_LANES - 1) / CHILLER_RNG_LANES * CHILLER_RNG_LANES;
+    std::vector<t_chiller_real> magnitude, phasor_re, phasor_im;
+    capture_sine(plan, frequency, magnitude, phasor_re, phasor_im);
+    std::vector<t_chiller_real> advance(num_bins, 0), phase_noise(padded), amp_noise(padded);
+    std::vector<std::complex<t_chiller_real>> bins(num_bins);
+    std::vector<t_chiller_real> work_re(plan->half_size), work_im(plan->half_size), grain(fft_size), ola(fft_size, 0);
+    t_chiller_rng rng;
+    chiller_rng_seed(&rng, 1);
+
+    // Spacing and gain as chiller_update_hop and chiller_update_gain set them
+    double spacing = (long)(fft_size / overlap + 0.5) / rate;
+    double sums[2], reference_sums[2];
+    chiller_overlap_sums(plan, spacing, &sums[0], &sums[1]);
+    chiller_overlap_sums(plan, fft_size / 4.0, &reference_sums[0], &reference_sums[1]);
+    double gain = chiller_overlap_level(reference_sums[0], reference_sums[1], phase_randomness, amplitude_variation)
+                / chiller_overlap_level(sums[0], sums[1], phase_randomness, amplitude_variation);
+
+    double countdown = 0.0, elapsed = 0.0, power = 0.0;
+    long read_pos = 0, count = 0;
+    for (long t = 0; t < TEST_SECONDS * TEST_SAMPLE_RATE; t++) {
+        while (countdown < 1.0) {
+            chiller_rng_fill(&rng, phase_noise.data(), num_bins);
+            chiller_rng_fill(&rng, amp_noise.data(), num_bins);
+            chiller_grain_advance(advance.data(), magnitude.data(), fft_size, elapsed + countdown);
+            chiller_grain_bins(bins.data(), magnitude.data(), phasor_re.data(), phasor_im.data(), advance.data(),
+                               phase_noise.data(), amp_noise.data(), fft_size, phase_randomness, amplitude_variation, countdown);
+            chiller_irfft(bins, work_re, work_im, grain, plan);
+            chiller_grain_overlap_add(grain.data(), plan->window.data(), fft_size, countdown, read_pos, ola.data(), 1, NULL, 0);
+            elapsed = -countdown;
+            countdown += spacing;
+        }
+        double sample = ola[read_pos] * gain;
+        ola[read_pos] = 0;
+        read_pos = (read_pos + 1) & mask;
+        countdown -= 1.0;
+        elapsed += 1.0;
+        if (t >= fft_size) {
+            power += sample * sample;
+            count++;
+        }
+    }
+    return sqrt(power / count);
+}
+
+int main(void) {
+    printf("Output level across overlap and rate, %s engine\n", chiller_test_precision());
+    chiller_fft_select_kernel();
+    chiller_phasor_table_init();
+    t_chiller_fft_plan *plan = chiller_fft_plan_acquire(TEST_FFT_SIZE);
+
+    // On bin 43, a quarter and half a bin off it
+    const double bin = (double)TEST_SAMPLE_RATE / TEST_FFT_SIZE;
+    const double frequencies[] = { 43.0 * bin, 43.25 * bin, 43.5 * bin };
+    const double noise[][2] = { { 0.0, 0.0 }, { 0.1, 0.1 }, { 1.0, 0.5 } };
+    const double overlaps[] = { 2.0, 4.0, 8.0 };
+    const double rates[] = { 1.0, 1.5, 2.0 };
+
+    for (const double *amounts : noise) {
+        double worst = 0.0;
+        for (double frequency : frequencies) {
+            double reference = render_rms(plan, frequency, 4.0, 1.0, amounts[0], amounts[1]);
+            for (double overlap : overlaps) {
+                for (double rate : rates) {
+                    double rms = render_rms(plan, frequency, overlap, rate, amounts[0], amounts[1]);
+                    worst = std::max(worst, fabs(20.0 * log10(rms / reference)));
+                }
+            }
+        }
+        char name[64];
+        snprintf(name, sizeof(name), "dB from overlap 4 (phaserand %.1f, ampvar %.1f)", amounts[0], amounts[1]);
+        chiller_test_check(name, worst, 1.0);
+    }
+
+    chiller_fft_plan_release(plan);
+    return chiller_test_failures ? 1 : 0;
+}
@@ -0,0 +1,54 @@
+// Bin rotation benchmark: the original std::polar per bin (a sin and a cos of
+// the stored phase plus the phase offset) against the phasor-table rotation
+// in chiller_grain_bins, per grain. Both apply the amplitude variation.
+
+#include "chiller_test.h"
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+int main(void) {
+    printf("Bin rotation time per grain in us, %s engine\n", chiller_test_precision());
+    printf("%8s %10s %10s %10s\n", "fft size", "polar", "table", "speedup");
+    chiller_phasor_table_init();
+    std::mt19937 mt(1);
+    std::uniform_real_distribution<double> dist(0.0, 1.0);
+    const double phase_randomness = 0.1, amplitude_variation = 0.1;
+
+    for (long fft_size = 512; fft_size <= 16384; fft_size *= 2) {
+        long num_bins = fft_size / 2 + 1;
+        long padded = (num_bins + CHILLER_RNG_LANES - 1) / CHILLER_RNG_LANES * CHILLER_RNG_LANES;
+        std::vector<double> phase(num_bins), magnitude(num_bins);
+        std::vector<t_chiller_real> grain_magnitude(num_bins), phasor_re(num_bins), phasor_im(num_bins), advance(num_bins, 0);
+        std::vector<t_chiller_real> phase_noise(padded), amp_noise(padded);
+        std::vector<std::complex<double>> polar_bins(num_bins);
+        std::vector<std::complex<t_chiller_real>> bins(num_bins);
+        for (long j = 0; j < num_bins; j++) {
+            phase[j] = 2.0 * M_PI * dist(mt);
+            magnitude[j] = dist(mt);
+            grain_magnitude[j] = (t_chiller_real)magnitude[j];
+            phasor_re[j] = (t_chiller_real)cos(phase[j]);
+            phasor_im[j] = (t_chiller_real)sin(phase[j]);
+        }
+        t_chiller_rng rng;
+        chiller_rng_seed(&rng, 1);
+        chiller_rng_fill(&rng, phase_noise.data(), num_bins);
+        chiller_rng_fill(&rng, amp_noise.data(), num_bins);
+
+        double reference = chiller_bench_time([&] {
+            for (long j = 0; j < num_bins; j++) {
+                double level = magnitude[j] * (1.0 + amp_noise[j] * amplitude_variation);
+                polar_bins[j] = std::polar(level, phase[j] + phase_noise[j] * M_PI * phase_randomness);
+            }
+            chiller_bench_sink = polar_bins[1].real();
+        });
+        double table = chiller_bench_time([&] {
+            chiller_grain_bins(bins.data(), grain_magnitude.data(), phasor_re.data(), phasor_im.data(), advance.data(),
+                               phase_noise.data(), amp_noise.data(), fft_size, phase_randomness, amplitude_variation, 0.25);
+            chiller_bench_sink = bins[1].real();
+        });
+        printf("%8ld %10.2f %10.2f %9.1fx\n", fft_size, reference * 1e6, table * 1e6, reference / table);
+    }
+    return 0;
+}
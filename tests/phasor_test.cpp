@@ -0,0 +1,89 @@
+// Error bound of the table-driven bin rotation (chiller_grain_bins).
+//
+// Each bin's phase offset is rounded to the nearest of CHILLER_PHASOR_TABLE_SIZE
+// unit phasors, so the rotated bin is off by at most pi / table size in phase,
+// i.e. 2 * sin(pi / (2 * size)) relative to its level. The bins are compared
+// with the exact rotation in long double over random spectra, noise, running
+// advances and onset delays; rounding to the nearest entry also leaves no
+// mean phase bias.
+
+#include "chiller_test.h"
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+// Rounding error of the engine precision on top of the table bound
+static const double chiller_test_slack = sizeof(t_chiller_real) == sizeof(float) ? 2e-6 : 1e-12;
+
+int main(void) {
+    printf("Phasor table rotation, %s engine\n", chiller_test_precision());
+    chiller_phasor_table_init();
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<double> dist(0.0, 1.0);
+    const double bound = M_PI / CHILLER_PHASOR_TABLE_SIZE;
+
+    // The table itself
+    double table_error = 0.0;
+    for (long k = 0; k < CHILLER_PHASOR_TABLE_SIZE; k++) {
+        long double angle = 2.0L * M_PI * k / CHILLER_PHASOR_TABLE_SIZE;
+        table_error = std::max(table_error, (double)fabsl(chiller_phasor_re[k] - cosl(angle)));
+        table_error = std::max(table_error, (double)fabsl(chiller_phasor_im[k] - sinl(angle)));
+    }
+    chiller_test_check("table entry error", table_error, chiller_test_slack);
+
+    double max_error = 0.0, dc_nyquist_imag = 0.0, bias = 0.0;
+    long count = 0;
+    for (long fft_size = 512; fft_size <= 8192; fft_size *= 2) {
+        long num_bins = fft_size / 2 + 1;
+        long padded = (num_bins + CHILLER_RNG_LANES - 1) / CHILLER_RNG_LANES * CHILLER_RNG_LANES;
+        std::vector<t_chiller_real> magnitude(num_bins), phasor_re(num_bins), phasor_im(num_bins), phase(num_bins), advance(num_bins);
+        std::vector<t_chiller_real> phase_noise(padded), amp_noise(padded);
+        std::vector<std::complex<t_chiller_real>> bins(num_bins);
+        t_chiller_rng noise;
+        chiller_rng_seed(&noise, fft_size);
+
+        for (long trial = 0; trial < 16; trial++) {
+            double phase_randomness = dist(rng);
+            double amplitude_variation = 0.5 * dist(rng);
+            double delay = trial == 0 ? 0.0 : dist(rng);
+            for (long j = 0; j < num_bins; j++) {
+                phase[j] = (t_chiller_real)(2.0 * M_PI * dist(rng));
+                magnitude[j] = (t_chiller_real)dist(rng);
+                phasor_re[j] = (t_chiller_real)cos(phase[j]);
+                phasor_im[j] = (t_chiller_real)sin(phase[j]);
+                advance[j] = trial == 0 ? 0 : (t_chiller_real)dist(rng);
+            }
+            chiller_rng_fill(&noise, phase_noise.data(), num_bins);
+            chiller_rng_fill(&noise, amp_noise.data(), num_bins);
+
+            chiller_grain_bins(bins.data(), magnitude.data(), phasor_re.data(), phasor_im.data(), advance.data(),
+                               phase_noise.data(), amp_noise.data(), fft_size, phase_randomness, amplitude_variation, delay);
+
+            // DC and Nyquist must come out real (their phase is dropped, so
+            // the comparison below skips them)
+            dc_nyquist_imag = std::max(dc_nyquist_imag, (double)fabs(bins[0].imag()));
+            dc_nyquist_imag = std::max(dc_nyquist_imag, (double)fabs(bins[num_bins - 1].imag()));
+
+            for (long j = 1; j < num_bins - 1; j++) {
+                long double level = (long double)magnitude[j] * (1 + (long double)amp_noise[j] * (t_chiller_real)amplitude_variation);
+                long double angle = (long double)phase[j] + phase_noise[j] * M_PI * phase_randomness - 2.0L * M_PI * advance[j]
+                                   + 2.0L * M_PI * j * delay / fft_size;
+                if (level < 1e-3) continue;
+                std::complex<long double> exact = std::polar(level, angle);
+                std::complex<long double> got(bins[j].real(), bins[j].imag());
+                max_error = std::max(max_error, (double)(std::abs(got - exact) / level));
+
+                // Signed phase error, wrapped to (-pi, pi]
+                long double error = std::arg(got / exact);
+                bias += (double)error;
+                count++;
+            }
+        }
+    }
+
+    chiller_test_check("bin error relative to its level", max_error, 2.0 * sin(bound / 2.0) + chiller_test_slack);
+    chiller_test_check("|mean phase error| in table steps", fabs(bias / count) / bound / 2.0, 0.01);
+    chiller_test_check("imaginary part of DC and Nyquist", dc_nyquist_imag, 0.0);
+    return chiller_test_failures ? 1 : 0;
+}
@@ -0,0 +1,41 @@
+// Grain noise benchmark: the original std::mt19937 draws through
+// std::uniform_real_distribution (a phase and an amplitude value per bin,
+// interleaved) against two bulk chiller_rng_fill calls, per grain.
+
+#include "chiller_test.h"
+
+#include <random>
+#include <vector>
+
+int main(void) {
+    printf("Grain noise time per grain in us, %s engine\n", chiller_test_precision());
+    printf("%8s %10s %10s %10s\n", "fft size", "mt19937", "xoshiro", "speedup");
+
+    std::mt19937 mt(1);
+    std::uniform_real_distribution<double> phase_dist(-M_PI, M_PI);
+    std::uniform_real_distribution<double> amp_dist(-1.0, 1.0);
+    t_chiller_rng rng;
+    chiller_rng_seed(&rng, 1);
+
+    for (long fft_size = 512; fft_size <= 16384; fft_size *= 2) {
+        long num_bins = fft_size / 2 + 1;
+        long padded = (num_bins + CHILLER_RNG_LANES - 1) / CHILLER_RNG_LANES * CHILLER_RNG_LANES;
+        std::vector<double> phase(num_bins), amp(num_bins);
+        std::vector<t_chiller_real> phase_noise(padded), amp_noise(padded);
+
+        double reference = chiller_bench_time([&] {
+            for (long j = 0; j < num_bins; j++) {
+                phase[j] = phase_dist(mt);
+                amp[j] = amp_dist(mt);
+            }
+            chiller_bench_sink = phase[num_bins - 1] + amp[num_bins - 1];
+        });
+        double bulk = chiller_bench_time([&] {
+            chiller_rng_fill(&rng, phase_noise.data(), num_bins);
+            chiller_rng_fill(&rng, amp_noise.data(), num_bins);
+            chiller_bench_sink = phase_noise[num_bins - 1] + amp_noise[num_bins - 1];
+        });
+        printf("%8ld %10.2f %10.2f %9.1fx\n", fft_size, reference * 1e6, bulk * 1e6, reference / bulk);
+    }
+    return 0;
+}
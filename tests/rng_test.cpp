@@ -0,0 +1,90 @@
+// Statistical checks of the grain noise generator (chiller_rng_fill).
+//
+// The generator is seeded, so every check is deterministic; the limits are
+// five standard deviations of each statistic for a uniform source, so a
+// correct generator passes them all by a wide margin.
+
+#include "chiller_test.h"
+
+#include <cmath>
+#include <vector>
+
+#define TEST_COUNT (1L << 20)
+#define TEST_HISTOGRAM_BINS 64
+
+static std::vector<t_chiller_real> draw(uint64_t seed, long count) {
+    t_chiller_rng rng;
+    chiller_rng_seed(&rng, seed);
+    std::vector<t_chiller_real> values(count);
+    // Several fills of a grain's size, as the engine draws them
+    for (long i = 0; i < count; i += 1024) {
+        chiller_rng_fill(&rng, values.data() + i, 1024);
+    }
+    return values;
+}
+
+static double correlation(const std::vector<t_chiller_real>& v, long lag) {
+    double sum = 0.0;
+    for (size_t i = lag; i < v.size(); i++) {
+        sum += (double)v[i] * v[i - lag];
+    }
+    // Variance of uniform [-1, 1) is 1/3
+    return fabs(sum / (v.size() - lag) * 3.0);
+}
+
+int main(void) {
+    printf("Grain noise generator, %s engine\n", chiller_test_precision());
+    std::vector<t_chiller_real> values = draw(1, TEST_COUNT);
+    double n = (double)TEST_COUNT;
+
+    // Range and resolution: multiples of 2^-23 in [-1, 1)
+    long outside = 0;
+    for (t_chiller_real v : values) {
+        double steps = (double)v * 8388608.0;
+        if (v < -1 || v >= 1 || steps != floor(steps)) outside++;
+    }
+    chiller_test_check("values outside [-1, 1) or off the 2^-23 grid", outside, 0);
+
+    // Mean and variance
+    double sum = 0.0, sum2 = 0.0;
+    for (t_chiller_real v : values) {
+        sum += v;
+        sum2 += (double)v * v;
+    }
+    chiller_test_check("|mean|", fabs(sum / n), 5.0 * sqrt(1.0 / 3.0 / n));
+    chiller_test_check("|variance - 1/3|", fabs(sum2 / n - 1.0 / 3.0), 5.0 * sqrt(4.0 / 45.0 / n));
+
+    // Chi-square of a histogram (TEST_HISTOGRAM_BINS - 1 degrees of freedom)
+    std::vector<long> histogram(TEST_HISTOGRAM_BINS, 0);
+    for (t_chiller_real v : values) {
+        histogram[(long)((v + 1) * (TEST_HISTOGRAM_BINS / 2))]++;
+    }
+    double expected = n / TEST_HISTOGRAM_BINS, chi2 = 0.0;
+    for (long count : histogram) {
+        chi2 += (count - expected) * (count - expected) / expected;
+    }
+    double dof = TEST_HISTOGRAM_BINS - 1;
+    chiller_test_check("histogram chi-square", chi2, dof + 5.0 * sqrt(2.0 * dof));
+
+    // Neighbouring values come from different lanes, values a lane group
+    // apart from the same lane
+    char what[64];
+    const long lags[] = { 1, 2, CHILLER_RNG_LANES - 1, CHILLER_RNG_LANES, CHILLER_RNG_LANES + 1 };
+    for (long lag : lags) {
+        snprintf(what, sizeof(what), "|correlation| at lag %ld", lag);
+        chiller_test_check(what, correlation(values, lag), 5.0 / sqrt(n));
+    }
+
+    // Seeding: the same seed repeats the sequence, another one does not
+    std::vector<t_chiller_real> again = draw(1, TEST_COUNT);
+    std::vector<t_chiller_real> other = draw(2, TEST_COUNT);
+    long differ = 0, same = 0;
+    for (long i = 0; i < TEST_COUNT; i++) {
+        if (again[i] != values[i]) differ++;
+        if (other[i] == values[i]) same++;
+    }
+    chiller_test_check("values differing with the same seed", differ, 0);
+    chiller_test_check("values equal with another seed", same, 5);   // 0.06 expected by chance
+
+    return chiller_test_failures ? 1 : 0;
+}